@@ -8,9 +8,162 @@
 #include "fifo_buffer.h"
 
 
+#if FIFO_BUFFER_MAX_WAITERS > 0
+/* Copies bytes out of the buffer from beginning, freeing the space they used */
+static void fifo_buffer_copy_out(fifo_buffer_ptr buffer_ptr, char* destination, unsigned short bytes) {
+
+	for (unsigned short i = 0; i < bytes; i++) {
+		destination[i] = buffer_ptr->buffer[buffer_ptr->beginning];
+
+		/* wrap around to make the array circular */
+		buffer_ptr->beginning = (buffer_ptr->beginning < BUFFER_SIZE - 1) ? buffer_ptr->beginning + 1 : 0;
+	}
+	buffer_ptr->space_left += bytes;
+}
+
+/* Copies bytes into the buffer at end, using up open space */
+static void fifo_buffer_copy_in(fifo_buffer_ptr buffer_ptr, const char* source, unsigned short bytes) {
+
+	for (unsigned short i = 0; i < bytes; i++) {
+		buffer_ptr->buffer[buffer_ptr->end] = source[i];
+
+		buffer_ptr->end = (buffer_ptr->end < BUFFER_SIZE - 1) ? buffer_ptr->end + 1 : 0;
+	}
+	buffer_ptr->space_left -= bytes;
+}
+
+/* 
+* Checks whether a waiter can complete with the current state of the buffer.
+* Read waiters need occupied bytes, write waiters need open bytes.
+*/
+static bool fifo_buffer_waiter_ready(fifo_buffer_ptr buffer_ptr, bool read, unsigned short bytes) {
+
+	if (read) {
+		return BUFFER_SIZE - buffer_ptr->space_left >= bytes;
+	}
+	else {
+		return buffer_ptr->space_left >= bytes;
+	}
+}
+
+/* Checks whether any read (or write) waiters are queued; plain gets (or puts) must wait behind them */
+static bool fifo_buffer_queued(fifo_buffer_ptr buffer_ptr, bool read) {
+
+	return (read ? buffer_ptr->read_count : buffer_ptr->write_count) > 0;
+}
+
+/* Removes position from a queue of waiter slot indices, keeping the rest in order */
+static void fifo_buffer_queue_remove(unsigned char* queue, unsigned char* count, int position) {
+
+	for (int i = position; i < *count - 1; i++) {
+		queue[i] = queue[i + 1];
+	}
+	*count -= 1;
+}
+
+/*
+* Completes the oldest waiter of one kind if the buffer can satisfy it. The bytes are copied
+* and the slot is freed before the callback runs, so the callback can wait again.
+* Returns true if a waiter was completed.
+*/
+static bool fifo_buffer_complete_head(fifo_buffer_ptr buffer_ptr, bool read) {
+
+	unsigned char* queue = read ? buffer_ptr->read_queue : buffer_ptr->write_queue;
+	unsigned char* count = read ? &buffer_ptr->read_count : &buffer_ptr->write_count;
+	fifo_buffer_waiter* waiter;
+	fifo_buffer_callback callback;
+	void* context;
+
+	if (*count == 0) return false;
+
+	waiter = &buffer_ptr->waiters[queue[0]];
+	if (!fifo_buffer_waiter_ready(buffer_ptr, read, waiter->bytes)) return false;
+
+	if (read) {
+		fifo_buffer_copy_out(buffer_ptr, waiter->data, waiter->bytes);
+	}
+	else {
+		fifo_buffer_copy_in(buffer_ptr, waiter->data, waiter->bytes);
+	}
+
+	callback = waiter->callback;
+	context = waiter->context;
+	waiter->callback = 0;
+	fifo_buffer_queue_remove(queue, count, 0);
+
+	callback(buffer_ptr, context);
+	return true;
+}
+
+/*
+* Completes every queued waiter the buffer can now satisfy. Completing a read frees space and
+* completing a write adds data, so this keeps going until neither queue can make progress.
+* put/get/wait calls made from a callback find notifying set and return; the loop here then
+* picks up whatever they changed.
+*/
+static void fifo_buffer_notify(fifo_buffer_ptr buffer_ptr) {
+
+	bool progress = true;
+
+	if (buffer_ptr->notifying) return;
+	buffer_ptr->notifying = true;
+
+	while (progress) {
+		progress = fifo_buffer_complete_head(buffer_ptr, true);
+		progress |= fifo_buffer_complete_head(buffer_ptr, false);
+	}
+
+	buffer_ptr->notifying = false;
+}
+
+/* 
+* Shared by wait_read and wait_write. Completes straight away if nothing of the same kind is
+* queued ahead and the buffer is ready, otherwise queues the waiter in a free slot.
+*/
+static fifo_buffer_wait_result fifo_buffer_wait(fifo_buffer_ptr buffer_ptr, bool read, char* data,
+	unsigned short bytes, fifo_buffer_callback callback, void* context) {
+
+	unsigned char* queue = read ? buffer_ptr->read_queue : buffer_ptr->write_queue;
+	unsigned char* count = read ? &buffer_ptr->read_count : &buffer_ptr->write_count;
+
+	if (bytes > BUFFER_SIZE || callback == 0) return FIFO_BUFFER_WAIT_FAILED; /* could never complete */
+
+	if (!fifo_buffer_queued(buffer_ptr, read) && fifo_buffer_waiter_ready(buffer_ptr, read, bytes)) {
+		if (read) {
+			fifo_buffer_copy_out(buffer_ptr, data, bytes);
+		}
+		else {
+			fifo_buffer_copy_in(buffer_ptr, data, bytes);
+		}
+		fifo_buffer_notify(buffer_ptr); /* waiters of the other kind may now be able to complete */
+		return FIFO_BUFFER_WAIT_COMPLETED;
+	}
+
+	for (int i = 0; i < FIFO_BUFFER_MAX_WAITERS; i++) {
+		if (buffer_ptr->waiters[i].callback == 0) {
+			buffer_ptr->waiters[i].callback = callback;
+			buffer_ptr->waiters[i].context = context;
+			buffer_ptr->waiters[i].data = data;
+			buffer_ptr->waiters[i].bytes = bytes;
+			buffer_ptr->waiters[i].read = read;
+
+			queue[*count] = (unsigned char)i;
+			*count += 1;
+			return FIFO_BUFFER_WAIT_QUEUED;
+		}
+	}
+	return FIFO_BUFFER_WAIT_FAILED; /* no free waiter slot; operation failed */
+}
+#else
+#define fifo_buffer_queued(buffer_ptr, read) false /* waiters are disabled */
+#define fifo_buffer_notify(buffer_ptr) /* waiters are disabled */
+#endif
+
+
 /*
 * Initialization for a new buffer. Sets all bytes to zero and
-* sets the positions in the buffer to the first byte. 
+* sets the positions in the buffer to the first byte. Clears the waiter slots; waiters still
+* queued are dropped without a callback (see fifo_buffer.h).
 * Not efficient for very large buffers but should only have to be run on
 * startup.
 */
@@ -23,6 +176,14 @@ bool fifo_buffer_init(fifo_buffer_ptr new_buffer_ptr) {
 	for (int i = 0; i < BUFFER_SIZE; i++) {
 		new_buffer_ptr->buffer[i] = 0x00;
 	}
+#if FIFO_BUFFER_MAX_WAITERS > 0
+	for (int i = 0; i < FIFO_BUFFER_MAX_WAITERS; i++) {
+		new_buffer_ptr->waiters[i].callback = 0;
+	}
+	new_buffer_ptr->read_count = 0;
+	new_buffer_ptr->write_count = 0;
+	new_buffer_ptr->notifying = false;
+#endif
 	return true;
 }
 
@@ -30,6 +191,8 @@ bool fifo_buffer_init(fifo_buffer_ptr new_buffer_ptr) {
 /* 8 bit char(Byte) operations */
 bool fifo_buffer_put_char(fifo_buffer_ptr buffer_ptr, char insert) {
 	
+	if (fifo_buffer_queued(buffer_ptr, false)) return false; /* queued writers get the space first */
+	
 	if (buffer_ptr->space_left > 0) { /* Check there is enough space to add the byte */
 		
 		/* different cases to ensure array is circular */
@@ -48,6 +211,7 @@ bool fifo_buffer_put_char(fifo_buffer_ptr buffer_ptr, char insert) {
 			buffer_ptr->end = 0; 
 			buffer_ptr->space_left -= 1;
 		}
+		fifo_buffer_notify(buffer_ptr); /* data was added; complete read waiters */
 		return true;
 	}
 	else {
@@ -57,6 +221,8 @@ bool fifo_buffer_put_char(fifo_buffer_ptr buffer_ptr, char insert) {
 }
 
 bool fifo_buffer_get_char(fifo_buffer_ptr buffer_ptr, char* value) {
+	
+	if (fifo_buffer_queued(buffer_ptr, true)) return false; /* queued readers get their bytes first */
 
 	if (buffer_ptr->space_left < BUFFER_SIZE) { /* Check there is a byte to return */
 		
@@ -73,6 +239,7 @@ bool fifo_buffer_get_char(fifo_buffer_ptr buffer_ptr, char* value) {
 			buffer_ptr->beginning = 0;
 			buffer_ptr->space_left += 1;
 		}
+		fifo_buffer_notify(buffer_ptr); /* space was freed; complete write waiters */
 		return true;
 	}
 	else return false; /* no char in buffer; operation failed */
@@ -82,6 +249,8 @@ bool fifo_buffer_get_char(fifo_buffer_ptr buffer_ptr, char* value) {
 /* 16 bit unsigned integer operations */
 bool fifo_buffer_put_uint16(fifo_buffer_ptr buffer_ptr, unsigned short insert) {
 	
+	if (fifo_buffer_queued(buffer_ptr, false)) return false; /* queued writers get the space first */
+	
 	if(buffer_ptr->space_left > 1){ /* check for sufficient space */
 		
 		/* More cases to deal with as we're inserting more bytes */
@@ -109,6 +278,7 @@ bool fifo_buffer_put_uint16(fifo_buffer_ptr buffer_ptr, unsigned short insert) {
 			buffer_ptr->end = 1;
 			buffer_ptr->space_left -= 2;
 		}
+		fifo_buffer_notify(buffer_ptr); /* data was added; complete read waiters */
 		return true;
 	}
 	else {
@@ -120,6 +290,8 @@ bool fifo_buffer_put_uint16(fifo_buffer_ptr buffer_ptr, unsigned short insert) {
 
 bool fifo_buffer_get_uint16(fifo_buffer_ptr buffer_ptr, unsigned short * value) {
 	
+	if (fifo_buffer_queued(buffer_ptr, true)) return false; /* queued readers get their bytes first */
+	
 	if (buffer_ptr->space_left < BUFFER_SIZE - 1) { /* check for uint16 to return */
 		/* different cases to make the array circular */
 		if (buffer_ptr->beginning < BUFFER_SIZE - 2) {
@@ -143,6 +315,7 @@ bool fifo_buffer_get_uint16(fifo_buffer_ptr buffer_ptr, unsigned short * value)
 			buffer_ptr->beginning = 1;
 			buffer_ptr->space_left += 2;
 		}
+		fifo_buffer_notify(buffer_ptr); /* space was freed; complete write waiters */
 		return true;
 	}
 	else return false; /* no uint16 in buffer; operation failed */ 
@@ -153,6 +326,8 @@ bool fifo_buffer_get_uint16(fifo_buffer_ptr buffer_ptr, unsigned short * value)
 /* 32 bit unsigned integer operations */
 bool fifo_buffer_put_uint32(fifo_buffer_ptr buffer_ptr, unsigned int insert){
 	
+	if (fifo_buffer_queued(buffer_ptr, false)) return false; /* queued writers get the space first */
+	
 	if (buffer_ptr->space_left > 3) { /* Check there is 4 bytes available*/
 		
 		if (buffer_ptr->end < BUFFER_SIZE - 4) {
@@ -209,6 +384,7 @@ bool fifo_buffer_put_uint32(fifo_buffer_ptr buffer_ptr, unsigned int insert){
 			buffer_ptr->end = 3;
 			buffer_ptr->space_left -= 4;
 		}
+		fifo_buffer_notify(buffer_ptr); /* data was added; complete read waiters */
 		return true;
 	}
 	else {
@@ -219,6 +395,8 @@ bool fifo_buffer_put_uint32(fifo_buffer_ptr buffer_ptr, unsigned int insert){
 }
 
 bool fifo_buffer_get_uint32(fifo_buffer_ptr buffer_ptr, unsigned int* value) {
+	
+	if (fifo_buffer_queued(buffer_ptr, true)) return false; /* queued readers get their bytes first */
 
 	if (buffer_ptr->space_left < BUFFER_SIZE - 3) { /* Check that 4 bytes are available */
 		
@@ -270,8 +448,48 @@ bool fifo_buffer_get_uint32(fifo_buffer_ptr buffer_ptr, unsigned int* value) {
 			buffer_ptr->beginning = 3;
 			buffer_ptr->space_left += 4;
 		}
+		fifo_buffer_notify(buffer_ptr); /* space was freed; complete write waiters */
 		return true;
 	}
 	else return false; /* no uint32 in buffer; operation failed*/
 
-}
\ No newline at end of file
+}
+
+
+#if FIFO_BUFFER_MAX_WAITERS > 0
+/* Waiter operations */
+fifo_buffer_wait_result fifo_buffer_wait_read(fifo_buffer_ptr buffer_ptr, char* destination,
+	unsigned short bytes, fifo_buffer_callback callback, void* context) {
+
+	return fifo_buffer_wait(buffer_ptr, true, destination, bytes, callback, context);
+}
+
+fifo_buffer_wait_result fifo_buffer_wait_write(fifo_buffer_ptr buffer_ptr, const char* source,
+	unsigned short bytes, fifo_buffer_callback callback, void* context) {
+
+	/* source is only ever read from; the waiter shares one data pointer for both kinds */
+	return fifo_buffer_wait(buffer_ptr, false, (char*)source, bytes, callback, context);
+}
+
+bool fifo_buffer_cancel_wait(fifo_buffer_ptr buffer_ptr, bool read,
+	fifo_buffer_callback callback, void* context) {
+
+	unsigned char* queue = read ? buffer_ptr->read_queue : buffer_ptr->write_queue;
+	unsigned char* count = read ? &buffer_ptr->read_count : &buffer_ptr->write_count;
+	fifo_buffer_waiter* waiter;
+
+	for (int i = 0; i < *count; i++) {
+		waiter = &buffer_ptr->waiters[queue[i]];
+
+		if (waiter->callback == callback && waiter->context == context) {
+			waiter->callback = 0;
+			fifo_buffer_queue_remove(queue, count, i);
+
+			/* the cancelled waiter may have been holding back the ones behind it */
+			fifo_buffer_notify(buffer_ptr);
+			return true;
+		}
+	}
+	return false; /* no matching waiter; operation failed */
+}
+#endif
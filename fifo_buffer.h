@@ -9,18 +9,70 @@
 /*
 * bool is defined as a macro in stdbool.h as type _Bool. We probably don't want to include it in
 * the main program but we want to return a value telling us if the operation succeeded so 
-* it must be defined here.
+* it must be defined here. C++ has a built in bool so it is left alone there.
 */
-#ifndef bool
+#if !defined(bool) && !defined(__cplusplus)
 	#define bool _Bool 
 	#define true 1
 	#define false 0
 #endif // !BOOL
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* number of bytes the buffer can hold */
 #define BUFFER_SIZE 8
 
-typedef struct fifo_buffer{
+/* 
+* Number of read/write waiters that can be queued on one buffer at a time. Waiters are opt-in:
+* with the default of 0 the buffer carries no waiter table and the wait operations are not
+* built. Define it (project wide, so every file sees the same struct) to enable them.
+*/
+#ifndef FIFO_BUFFER_MAX_WAITERS
+	#define FIFO_BUFFER_MAX_WAITERS 0
+#endif
+
+/* waiter slot indices and counts are stored in unsigned chars */
+#if FIFO_BUFFER_MAX_WAITERS > 255
+	#error "FIFO_BUFFER_MAX_WAITERS can be at most 255"
+#endif
+
+typedef struct fifo_buffer fifo_buffer, * fifo_buffer_ptr;
+
+#if FIFO_BUFFER_MAX_WAITERS > 0
+/* 
+* Completion callback for a waiter. Called after the buffer has copied the waiter's bytes
+* (into its destination for a read, from its source for a write). The waiter has already been
+* removed from the buffer when this is called, so the callback can get/put and wait again.
+* It is called from inside the put/get/wait/cancel that completed the waiter and must not
+* destroy or init the buffer; a scheduler should just queue the waiting task and run it later.
+*/
+typedef void (*fifo_buffer_callback)(fifo_buffer_ptr buffer_ptr, void* context);
+
+typedef struct fifo_buffer_waiter{
+
+	fifo_buffer_callback callback; /* NULL if the slot is free */
+	void* context;
+
+	/* bytes to copy; destination for a read, source for a write (only read from) */
+	char* data;
+	unsigned short bytes;
+	
+	/* true if waiting for data (read), false if waiting for open space (write) */
+	bool read;
+
+}fifo_buffer_waiter;
+
+/* Result of a wait operation */
+typedef enum fifo_buffer_wait_result{
+	FIFO_BUFFER_WAIT_FAILED = 0,	/* bytes larger than the buffer or no free waiter slot */
+	FIFO_BUFFER_WAIT_COMPLETED,	/* bytes were copied before returning; callback is not called */
+	FIFO_BUFFER_WAIT_QUEUED		/* bytes will be copied later, then callback is called */
+}fifo_buffer_wait_result;
+#endif
+
+struct fifo_buffer{
 	
 	char buffer[BUFFER_SIZE];
 	
@@ -30,16 +82,32 @@ typedef struct fifo_buffer{
 	*/
 	unsigned short beginning, end, space_left; 
 
-}fifo_buffer, * fifo_buffer_ptr;
+#if FIFO_BUFFER_MAX_WAITERS > 0
+	/* waiter slots, and the slot indices of queued read and write waiters in FIFO order */
+	fifo_buffer_waiter waiters[FIFO_BUFFER_MAX_WAITERS];
+	unsigned char read_queue[FIFO_BUFFER_MAX_WAITERS], write_queue[FIFO_BUFFER_MAX_WAITERS];
+	unsigned char read_count, write_count;
+
+	/* set while waiters are being completed so nested put/get/wait calls don't recurse */
+	bool notifying;
+#endif
+
+};
 
 /* 
 * All operations return true if they complete; false if they do not.
 * Put operations fail if they do not have enough space in the buffer to insert
 * the value. Get operations fail if there is not enough occupied bytes to return
 * the requested type.
+* With waiters enabled, a get also fails while a read waiter is queued and a put fails while
+* a write waiter is queued, so the plain operations can't take bytes (or space) out from under
+* a waiter that is ahead of them.
 */
 
-/* Initializes the values of a new fifo buffer*/
+/* 
+* Initializes the values of a new fifo buffer. Must not be called on a buffer that still has
+* queued waiters: they are dropped without their callbacks being called. Cancel them first.
+*/
 bool fifo_buffer_init(fifo_buffer_ptr new_buffer_ptr);
 
 
@@ -67,4 +135,42 @@ bool fifo_buffer_get_uint16(fifo_buffer_ptr buffer_ptr, unsigned short* value);
 bool fifo_buffer_put_uint32(fifo_buffer_ptr buffer_ptr, unsigned int insert);
 
 /* Removes uint32 from buffer and stores at address pointed to by passed pointer */
-bool fifo_buffer_get_uint32(fifo_buffer_ptr buffer_ptr, unsigned int* value);
\ No newline at end of file
+bool fifo_buffer_get_uint32(fifo_buffer_ptr buffer_ptr, unsigned int* value);
+
+
+#if FIFO_BUFFER_MAX_WAITERS > 0
+/* 
+* Waiter operations 
+* Instead of polling the get/put operations until they return true, a consumer (or producer)
+* can queue a read (or write) that the buffer completes itself once enough bytes (or space)
+* are there. Each waiter's bytes are copied before its callback is called, so two waiters can
+* never be handed the same bytes. Waiters of each kind complete in the order they were queued;
+* a waiter that can't complete yet holds back the ones behind it. Every successful put or get
+* completes all waiters it makes possible, so a single thread can service many buffers without
+* spinning. The callback should usually just queue work (eg. schedule a coroutine). Plain
+* put/get calls wait their turn behind queued waiters of the same kind (they fail instead).
+*/
+
+/* 
+* Reads bytes from the buffer into destination. If no earlier read is queued and the bytes are
+* already there they are copied straight away and FIFO_BUFFER_WAIT_COMPLETED is returned.
+*/
+fifo_buffer_wait_result fifo_buffer_wait_read(fifo_buffer_ptr buffer_ptr, char* destination,
+	unsigned short bytes, fifo_buffer_callback callback, void* context);
+
+/* 
+* Writes bytes from source into the buffer. If no earlier write is queued and there is space
+* they are copied straight away and FIFO_BUFFER_WAIT_COMPLETED is returned. source must stay
+* valid until the callback is called.
+*/
+fifo_buffer_wait_result fifo_buffer_wait_write(fifo_buffer_ptr buffer_ptr, const char* source,
+	unsigned short bytes, fifo_buffer_callback callback, void* context);
+
+/* Removes a queued read (or write) waiter with matching callback and context. Fails if there is none. */
+bool fifo_buffer_cancel_wait(fifo_buffer_ptr buffer_ptr, bool read,
+	fifo_buffer_callback callback, void* context);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,141 @@
+/*
+*	C++20 coroutine wrapper for the fifo buffer waiter operations.
+*	co_await fifo_buffer_read(executor, buffer, destination) suspends until the bytes have been
+*	copied out of the buffer; co_await fifo_buffer_write(executor, buffer, source) until they
+*	have been copied in. Both evaluate to false if the wait could not be queued (too many bytes
+*	or no free slot). A completed coroutine is not resumed by the put/get that completed it; it
+*	is put on the executor's ready list and resumed by fifo_buffer_executor::run, so one thread
+*	can drive any number of buffers without nesting coroutines on each other's stacks.
+*	The C library never includes this file. FIFO_BUFFER_MAX_WAITERS must be defined the same
+*	way for the C files as for the files that include this one.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <span>
+
+#include "fifo_buffer.h"
+
+#if FIFO_BUFFER_MAX_WAITERS == 0
+	#error "fifo_buffer_coro.hpp needs FIFO_BUFFER_MAX_WAITERS > 0"
+#endif
+
+/*
+* Ready list of coroutines whose waits have completed. Completions only add to it; run
+* resumes them in completion order until nothing is left, including any that the resumed
+* coroutines complete in turn.
+*/
+class fifo_buffer_executor {
+public:
+	void schedule(std::coroutine_handle<> handle) { ready.push_back(handle); }
+
+	/* Drops a scheduled coroutine that is being destroyed before it ran */
+	void unschedule(std::coroutine_handle<> handle) {
+		ready.erase(std::remove(ready.begin(), ready.end(), handle), ready.end());
+	}
+
+	/* Resumes ready coroutines until there are none left; returns how many were resumed */
+	std::size_t run() {
+		std::size_t resumed = 0;
+
+		while (!ready.empty()) {
+			std::coroutine_handle<> handle = ready.front();
+			ready.pop_front();
+			handle.resume();
+			resumed++;
+		}
+		return resumed;
+	}
+
+	bool empty() const { return ready.empty(); }
+
+private:
+	std::deque<std::coroutine_handle<>> ready;
+};
+
+/*
+* Awaiter shared by reads and writes. It is the waiter's context, which is safe since the
+* awaiter lives in the suspended coroutine's frame until it is resumed. When the wait
+* completes the coroutine is scheduled on the executor. If the coroutine is destroyed while
+* suspended its queued wait is cancelled, or it is taken back off the ready list.
+*/
+class fifo_buffer_awaiter {
+public:
+	fifo_buffer_awaiter(fifo_buffer_executor& executor, fifo_buffer_ptr buffer_ptr, char* data,
+		std::size_t bytes, bool read)
+		: executor(executor), buffer_ptr(buffer_ptr), data(data), bytes(bytes), read(read) {}
+
+	fifo_buffer_awaiter(const fifo_buffer_awaiter&) = delete;
+	fifo_buffer_awaiter& operator=(const fifo_buffer_awaiter&) = delete;
+
+	~fifo_buffer_awaiter() {
+		if (result == FIFO_BUFFER_WAIT_QUEUED && !completed) {
+			fifo_buffer_cancel_wait(buffer_ptr, read, &fifo_buffer_awaiter::complete, this);
+		}
+		else if (completed && !resumed) {
+			executor.unschedule(waiting);
+		}
+	}
+
+	/* The wait itself decides; a ready buffer is completed in await_suspend without suspending */
+	bool await_ready() const noexcept { return false; }
+
+	/* Returns false (resume straight away) unless the wait was queued */
+	bool await_suspend(std::coroutine_handle<> handle) {
+		waiting = handle;
+
+		if (bytes > BUFFER_SIZE) {
+			result = FIFO_BUFFER_WAIT_FAILED;
+		}
+		else if (read) {
+			result = fifo_buffer_wait_read(buffer_ptr, data, (unsigned short)bytes,
+				&fifo_buffer_awaiter::complete, this);
+		}
+		else {
+			result = fifo_buffer_wait_write(buffer_ptr, data, (unsigned short)bytes,
+				&fifo_buffer_awaiter::complete, this);
+		}
+		return result == FIFO_BUFFER_WAIT_QUEUED;
+	}
+
+	/* true once the bytes have been copied */
+	bool await_resume() noexcept {
+		resumed = true;
+		return result != FIFO_BUFFER_WAIT_FAILED;
+	}
+
+private:
+	static void complete(fifo_buffer_ptr, void* context) {
+		fifo_buffer_awaiter* awaiter = static_cast<fifo_buffer_awaiter*>(context);
+
+		/* only schedule: resuming here would run the coroutine inside the put/get's notify */
+		awaiter->completed = true;
+		awaiter->executor.schedule(awaiter->waiting);
+	}
+
+	fifo_buffer_executor& executor;
+	fifo_buffer_ptr buffer_ptr;
+	char* data;
+	std::size_t bytes;
+	bool read;
+
+	fifo_buffer_wait_result result = FIFO_BUFFER_WAIT_FAILED;
+	bool completed = false, resumed = false;
+	std::coroutine_handle<> waiting;
+};
+
+/* Reads destination.size() bytes out of the buffer */
+inline fifo_buffer_awaiter fifo_buffer_read(fifo_buffer_executor& executor, fifo_buffer& buffer,
+	std::span<char> destination) {
+	return fifo_buffer_awaiter(executor, &buffer, destination.data(), destination.size(), true);
+}
+
+/* Writes source.size() bytes into the buffer */
+inline fifo_buffer_awaiter fifo_buffer_write(fifo_buffer_executor& executor, fifo_buffer& buffer,
+	std::span<const char> source) {
+	/* source is only read from; see fifo_buffer_wait_write */
+	return fifo_buffer_awaiter(executor, &buffer, const_cast<char*>(source.data()), source.size(), false);
+}
@@ -0,0 +1,178 @@
+// fifo_buffer_coro_test.cpp : Testbench for the C++20 coroutine wrapper
+// Build with FIFO_BUFFER_MAX_WAITERS defined for both files, eg.
+//   gcc -DFIFO_BUFFER_MAX_WAITERS=4 -c fifo_buffer.c
+//   g++ -std=c++20 -DFIFO_BUFFER_MAX_WAITERS=4 fifo_buffer_coro_test.cpp fifo_buffer.o
+//
+
+#include <cstdio>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include "fifo_buffer_coro.hpp"
+
+
+//number of buffers a byte is passed through in the pipeline test; deep enough that resuming
+//each stage from inside the previous stage's write would overflow the stack
+#define PIPELINE_STAGES 20000
+
+
+//minimal coroutine type: starts straight away and is destroyed by its owner
+struct debug_task {
+    struct promise_type {
+        debug_task get_return_object() { return debug_task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit debug_task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    debug_task(debug_task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    debug_task(const debug_task&) = delete;
+    ~debug_task() { if (handle) handle.destroy(); }
+    bool done() const { return handle.done(); }
+};
+
+
+//reads messages of 4 bytes until it has read count of them
+debug_task debug_consumer(fifo_buffer_executor& executor, fifo_buffer& buffer, int count, unsigned int* total) {
+    char message[4];
+    for (int i = 0; i < count; i++) {
+        bool success = co_await fifo_buffer_read(executor, buffer, message);
+        unsigned int value = (unsigned char)message[0] | (unsigned char)message[1] << 8
+            | (unsigned char)message[2] << 16 | (unsigned int)(unsigned char)message[3] << 24;
+        printf("Consumer read success: %d, value: %X\n", success, value);
+        *total += value;
+    }
+}
+
+//writes count messages of 4 bytes, more than the buffer can hold at once
+debug_task debug_producer(fifo_buffer_executor& executor, fifo_buffer& buffer, int count) {
+    for (int i = 0; i < count; i++) {
+        const char message[4] = { (char)i, 0, 0, 0 };
+        bool success = co_await fifo_buffer_write(executor, buffer, message);
+        printf("Producer write %d success: %d\n", i, success);
+    }
+}
+
+//reads from a buffer that is already full; must not suspend or resume itself recursively
+debug_task debug_drain(fifo_buffer_executor& executor, fifo_buffer& buffer, int* reads) {
+    char byte;
+    //co_await is kept out of the loop condition; gcc 12 gets it wrong next to &&
+    while (*reads < BUFFER_SIZE) {
+        if (!co_await fifo_buffer_read(executor, buffer, std::span<char>(&byte, 1))) break;
+        *reads += 1;
+    }
+}
+
+//one pipeline stage: reads a byte from in, adds one and writes it to out
+debug_task debug_stage(fifo_buffer_executor& executor, fifo_buffer& in, fifo_buffer& out) {
+    char byte;
+    if (!co_await fifo_buffer_read(executor, in, std::span<char>(&byte, 1))) co_return;
+    byte = (char)((unsigned char)byte + 1);
+    co_await fifo_buffer_write(executor, out, std::span<const char>(&byte, 1));
+}
+
+//owns its buffer and frees it as soon as its read completes
+debug_task debug_owner(fifo_buffer_executor& executor, fifo_buffer** owned, bool* finished) {
+    fifo_buffer* buffer = new fifo_buffer;
+    char byte;
+    fifo_buffer_init(buffer);
+    *owned = buffer;
+
+    co_await fifo_buffer_read(executor, *buffer, std::span<char>(&byte, 1));
+    delete buffer;
+    *finished = true;
+}
+
+
+int main()
+{
+    fifo_buffer_executor executor;
+    fifo_buffer test;
+    int failures = 0;
+
+    //consumer waits first, producer then fills it through the buffer
+    fifo_buffer_init(&test);
+    unsigned int total = 0;
+    debug_task consumer = debug_consumer(executor, test, 5, &total);
+    debug_task producer = debug_producer(executor, test, 5);
+    executor.run();
+    printf("Consumer done (1 here): %d, producer done (1 here): %d, total (A here): %X\n",
+        consumer.done(), producer.done(), total);
+    failures += !consumer.done() || !producer.done() || total != 0xA;
+
+    //ready buffer: every read completes without suspending
+    fifo_buffer_init(&test);
+    fifo_buffer_put_uint32(&test, 0x11223344);
+    fifo_buffer_put_uint32(&test, 0x55667788);
+    int reads = 0;
+    debug_task drain = debug_drain(executor, test, &reads);
+    printf("Drain done (1 here): %d, reads (8 here): %d, scheduled (0 here): %d\n",
+        drain.done(), reads, !executor.empty());
+    failures += !drain.done() || reads != BUFFER_SIZE || !executor.empty();
+
+    //reading more than the buffer holds fails instead of suspending
+    char too_big[BUFFER_SIZE + 1];
+    bool big_success = true;
+    auto big_read = [&]() -> debug_task { big_success = co_await fifo_buffer_read(executor, test, too_big); };
+    debug_task big = big_read();
+    printf("Oversized read success (0 here): %d\n", big_success);
+    failures += big_success || !big.done();
+
+    //destroying a suspended coroutine cancels its wait
+    fifo_buffer_init(&test);
+    {
+        unsigned int unused = 0;
+        debug_task abandoned = debug_consumer(executor, test, 1, &unused);
+    }
+    fifo_buffer_put_uint32(&test, 0xDEADBEEF);
+    printf("Bytes left after abandoned consumer (4 here): %d\n", BUFFER_SIZE - test.space_left);
+    failures += BUFFER_SIZE - test.space_left != 4;
+
+    //destroying a coroutine that was completed but not yet run takes it off the ready list
+    fifo_buffer_init(&test);
+    {
+        unsigned int unused = 0;
+        debug_task abandoned = debug_consumer(executor, test, 1, &unused);
+        fifo_buffer_put_uint32(&test, 0xDEADBEEF);
+        printf("Completed consumer scheduled (1 here): %d\n", !executor.empty());
+        failures += executor.empty();
+    }
+    printf("Resumed after abandoned completed consumer (0 here): %zu\n", executor.run());
+
+    //a put only schedules, so the coroutine can free the buffer once it runs
+    fifo_buffer* owned = 0;
+    bool owner_finished = false;
+    debug_task owner = debug_owner(executor, &owned, &owner_finished);
+    fifo_buffer_put_char(owned, 0x01);
+    printf("Owner finished before run (0 here): %d\n", owner_finished);
+    failures += owner_finished;
+    executor.run();
+    printf("Owner finished after run (1 here): %d\n", owner_finished);
+    failures += !owner_finished;
+
+    //a byte passed through PIPELINE_STAGES buffers, one coroutine per stage, from one put
+    std::vector<fifo_buffer> rings(PIPELINE_STAGES + 1);
+    std::vector<debug_task> stages;
+    stages.reserve(PIPELINE_STAGES);
+    for (fifo_buffer& ring : rings) fifo_buffer_init(&ring);
+    for (int i = 0; i < PIPELINE_STAGES; i++) {
+        stages.push_back(debug_stage(executor, rings[i], rings[i + 1]));
+    }
+    fifo_buffer_put_char(&rings[0], 0x00);
+    std::size_t resumed = executor.run();
+    char result = 0;
+    bool result_success = fifo_buffer_get_char(&rings[PIPELINE_STAGES], &result);
+    printf("Pipeline resumed (%d here): %zu, result read: %d, result (%hhX here): %hhX\n",
+        PIPELINE_STAGES, resumed, result_success, (char)(PIPELINE_STAGES & 0xFF), result);
+    failures += resumed != PIPELINE_STAGES || !result_success || result != (char)(PIPELINE_STAGES & 0xFF);
+    for (debug_task& stage : stages) failures += !stage.done();
+
+    printf("\nTests completed, failures: %d\n", failures);
+    return failures != 0;
+}
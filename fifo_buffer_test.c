@@ -1,8 +1,11 @@
 // fifo_buffer_test.c : Testbench to help debug 
+// The waiter tests only run when built with FIFO_BUFFER_MAX_WAITERS of 2 or more, eg.
+//   gcc -DFIFO_BUFFER_MAX_WAITERS=4 fifo_buffer.c fifo_buffer_test.c
 //
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "fifo_buffer.h"
 
@@ -20,6 +23,42 @@
 #define RANDOM_OPS 1
 
 
+#if FIFO_BUFFER_MAX_WAITERS == 1
+    #error "the waiter tests need FIFO_BUFFER_MAX_WAITERS of 2 or more (or 0 to skip them)"
+#endif
+
+#if FIFO_BUFFER_MAX_WAITERS > 0
+//prints a waiter test result next to the expected value; returns 1 if they differ
+int debug_check(const char* label, int value, int expected) {
+    printf("%s: %d (%d here)%s\n", label, value, expected, value == expected ? "" : "  <-- FAILED");
+    return value != expected;
+}
+
+//waiter callback: counts completions in the int pointed to by context
+void debug_waiter_callback(fifo_buffer_ptr buffer_ptr, void* context) {
+    int* completions = (int*)context;
+    *completions += 1;
+    printf("Waiter completed, bytes in buffer: %d\n", BUFFER_SIZE - buffer_ptr->space_left);
+}
+
+//waiter callback: reads one more byte each time it completes, until it has three
+//a wait made from here can complete straight away, in which case there is no callback for it
+char rewait_bytes[3];
+int rewait_count = 0;
+void debug_rewait_callback(fifo_buffer_ptr buffer_ptr, void* context) {
+    int result = FIFO_BUFFER_WAIT_COMPLETED;
+    while (result == FIFO_BUFFER_WAIT_COMPLETED) {
+        rewait_count += 1;
+        printf("Re-waiting reader completed %d times, got: %hhX\n", rewait_count, rewait_bytes[rewait_count - 1]);
+        if (rewait_count == 3) return;
+
+        result = fifo_buffer_wait_read(buffer_ptr, &rewait_bytes[rewait_count], 1, debug_rewait_callback, context);
+        printf("Wait from inside callback returned: %d\n", result);
+    }
+}
+#endif
+
+
 //function to display the buffer
 void debug_display_buffer(fifo_buffer_ptr buffer_ptr) {
     int bytes_to_print = BUFFER_SIZE - buffer_ptr->space_left;
@@ -223,6 +262,99 @@ int main()
     }
 #endif
 
+#if FIFO_BUFFER_MAX_WAITERS > 0
+    /***************************/
+    //Waiter tests (build with FIFO_BUFFER_MAX_WAITERS defined to enable)
+    //Wait results: 0 failed, 1 completed straight away, 2 queued
+
+    fifo_buffer_init(testptr);
+    int reader_a = 0, reader_b = 0, reader_c = 0, writer = 0;
+    int waiter_failures = 0;
+    char read_a[4] = { 0 }, read_b[4] = { 0 }, read_c[8] = { 0 };
+    char write_data[8] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x08 };
+
+    //two readers competing for the same bytes: only the first one queued gets them
+    waiter_failures += debug_check("Queue 4 byte reader A returned",
+        fifo_buffer_wait_read(testptr, read_a, 4, debug_waiter_callback, &reader_a), FIFO_BUFFER_WAIT_QUEUED);
+    waiter_failures += debug_check("Queue 4 byte reader B returned",
+        fifo_buffer_wait_read(testptr, read_b, 4, debug_waiter_callback, &reader_b), FIFO_BUFFER_WAIT_QUEUED);
+    fifo_buffer_put_uint32(testptr, 0x12345678);
+    waiter_failures += debug_check("Reader A completed after one uint32 put", reader_a, 1);
+    waiter_failures += debug_check("Reader B completed after one uint32 put", reader_b, 0);
+    waiter_failures += debug_check("Reader A got 0x12 last", (unsigned char)read_a[3], 0x12);
+
+    //plain operations can't jump the queues: get fails while a reader is queued
+    waiter_failures += debug_check("Put char while reader B queued succeeded?", fifo_buffer_put_char(testptr, 0x01), true);
+    waiter_failures += debug_check("Get char while reader B queued succeeded?", fifo_buffer_get_char(testptr, &returned_char), false);
+    fifo_buffer_put_uint16(testptr, 0x0302);
+    fifo_buffer_put_char(testptr, 0x04);
+    waiter_failures += debug_check("Reader B completed after 4 more bytes", reader_b, 1);
+    waiter_failures += debug_check("Reader B got 0x04 last", read_b[3], 0x04);
+
+    //immediate completion: bytes are already there so no callback is made
+    fifo_buffer_put_uint16(testptr, 0xBEEF);
+    waiter_failures += debug_check("Read of ready bytes returned",
+        fifo_buffer_wait_read(testptr, read_c, 2, debug_waiter_callback, &reader_c), FIFO_BUFFER_WAIT_COMPLETED);
+    waiter_failures += debug_check("Callbacks for immediate read", reader_c, 0);
+    waiter_failures += debug_check("Immediate read got 0xBE last", (unsigned char)read_c[1], 0xBE);
+
+    //failures
+    waiter_failures += debug_check("Read larger than buffer returned",
+        fifo_buffer_wait_read(testptr, read_c, BUFFER_SIZE + 1, debug_waiter_callback, &reader_c), FIFO_BUFFER_WAIT_FAILED);
+
+    fifo_buffer_init(testptr);
+    writer = 0;
+    fifo_buffer_put_uint32(testptr, 0x01020304);
+    fifo_buffer_put_uint32(testptr, 0x05060708);
+    for (int i = 0; i < FIFO_BUFFER_MAX_WAITERS; i++) {
+        waiter_failures += debug_check("Queue writer on full buffer returned",
+            fifo_buffer_wait_write(testptr, write_data, 1, debug_waiter_callback, &writer), FIFO_BUFFER_WAIT_QUEUED);
+    }
+    waiter_failures += debug_check("Writer with all slots full returned",
+        fifo_buffer_wait_write(testptr, write_data, 1, debug_waiter_callback, &writer), FIFO_BUFFER_WAIT_FAILED);
+    waiter_failures += debug_check("Put char while writers queued succeeded?", fifo_buffer_put_char(testptr, 0x01), false);
+    waiter_failures += debug_check("Reader of ready bytes with all slots full returned",
+        fifo_buffer_wait_read(testptr, read_c, 1, debug_waiter_callback, &reader_c), FIFO_BUFFER_WAIT_COMPLETED);
+    waiter_failures += debug_check("Writers completed by that read", writer, 1);
+
+    //cancelling: wrong direction and unknown waiters fail, queued ones succeed
+    waiter_failures += debug_check("Cancel writer as a reader succeeded?",
+        fifo_buffer_cancel_wait(testptr, true, debug_waiter_callback, &writer), false);
+    waiter_failures += debug_check("Cancel waiter that isn't queued succeeded?",
+        fifo_buffer_cancel_wait(testptr, false, debug_waiter_callback, &reader_a), false);
+    for (int i = 1; i < FIFO_BUFFER_MAX_WAITERS; i++) {
+        waiter_failures += debug_check("Cancel queued writer succeeded?",
+            fifo_buffer_cancel_wait(testptr, false, debug_waiter_callback, &writer), true);
+    }
+    waiter_failures += debug_check("Cancel with no writers left succeeded?",
+        fifo_buffer_cancel_wait(testptr, false, debug_waiter_callback, &writer), false);
+    
+    //writer waiting for space is completed by a get
+    fifo_buffer_init(testptr);
+    writer = 0;
+    fifo_buffer_put_uint32(testptr, 0x01020304);
+    fifo_buffer_put_uint16(testptr, 0x0506);
+    waiter_failures += debug_check("Queue 4 byte writer returned",
+        fifo_buffer_wait_write(testptr, write_data, 4, debug_waiter_callback, &writer), FIFO_BUFFER_WAIT_QUEUED);
+    fifo_buffer_get_char(testptr, &returned_char);
+    waiter_failures += debug_check("Writer completed after char get", writer, 0);
+    fifo_buffer_get_char(testptr, &returned_char);
+    waiter_failures += debug_check("Writer completed after second char get", writer, 1);
+    debug_display_buffer(testptr);
+
+    //a callback that waits again from inside the completion
+    fifo_buffer_init(testptr);
+    waiter_failures += debug_check("Queue re-waiting reader returned",
+        fifo_buffer_wait_read(testptr, &rewait_bytes[0], 1, debug_rewait_callback, 0), FIFO_BUFFER_WAIT_QUEUED);
+    fifo_buffer_put_uint16(testptr, 0xBBAA); //completes once, then again straight away, then queues
+    fifo_buffer_put_char(testptr, (char)0xCC);
+    waiter_failures += debug_check("Re-waiting reader completions", rewait_count, 3);
+    waiter_failures += debug_check("Bytes left after re-waiting reader", BUFFER_SIZE - testptr->space_left, 0);
+
+    printf("\nWaiter tests failed: %d\n", waiter_failures);
+    if (waiter_failures != 0) return 1;
+#endif
+
     printf("\nTests completed\n");
     return 0;
     